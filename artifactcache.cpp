@@ -0,0 +1,121 @@
+/*
+ * artifactcache.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include "artifactcache.h"
+#include "parallel.h"
+#include "sha256.h"
+
+std::filesystem::path ArtifactCache::entry(const std::string &fingerprint) const {
+	return dir / fingerprint.substr(0,2) / fingerprint;
+}
+
+bool ArtifactCache::restore(const std::string &fingerprint, const std::filesystem::path &base) const {
+	auto edir = entry(fingerprint);
+	std::ifstream manifest(edir / "manifest", std::ios::in);
+	if (!manifest) return false;
+	std::vector<std::filesystem::path> files;
+	std::string ln;
+	while (std::getline(manifest, ln)) {
+		if (ln.empty()) continue;
+		std::filesystem::path f(ln);
+		//the cache is shared, the entry must not write outside of the output directory
+		if (f.has_root_path()) return false;
+		for (const auto &part: f) if (part == "..") return false;
+		//damaged entry is treated as a cache miss
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(edir / "files" / f, ec)) return false;
+		files.push_back(std::move(f));
+	}
+	if (files.empty()) return false;
+	try {
+		std::set<std::filesystem::path> dirs;
+		for (const auto &f: files) dirs.insert((base / f).parent_path());
+		for (const auto &d: dirs) std::filesystem::create_directories(d);
+		std::vector<Job> jobs;
+		for (const auto &f: files) {
+			jobs.push_back([&]{
+				std::filesystem::copy_file(edir / "files" / f, base / f, std::filesystem::copy_options::overwrite_existing);
+			});
+		}
+		runParallel(jobs);
+	} catch (const std::exception &) {
+		//outputs are rewritten by the build
+		return false;
+	}
+	return true;
+}
+
+void ArtifactCache::store(const std::string &fingerprint, const std::filesystem::path &base,
+		const std::vector<std::filesystem::path> &files) const {
+	auto edir = entry(fingerprint);
+	if (std::filesystem::exists(edir / "manifest")) return;
+	std::vector<std::string> rels;
+	for (const auto &f: files) {
+		auto rel = f.lexically_relative(base);
+		if (rel.empty() || *rel.begin() == "..") {
+			throw std::runtime_error(f.string()+": output is outside of the output directory, can't be cached");
+		}
+		rels.push_back(rel.generic_string());
+	}
+	//unique directory, the cache can be shared by many machines, so pid is not enough
+	std::filesystem::create_directories(edir.parent_path());
+	std::string tmpname = (edir.parent_path() / (fingerprint + ".tmp.XXXXXX")).string();
+	if (!mkdtemp(tmpname.data())) throw std::runtime_error(tmpname + ": failed to create directory");
+	std::filesystem::path tmp(tmpname);
+	//mkdtemp creates private directory, but the entry is shared
+	std::filesystem::permissions(tmp, std::filesystem::perms::owner_all | std::filesystem::perms::group_read
+			| std::filesystem::perms::group_exec | std::filesystem::perms::others_read | std::filesystem::perms::others_exec);
+	try {
+		storeFiles(tmp, files, rels);
+	} catch (...) {
+		std::error_code ec;
+		std::filesystem::remove_all(tmp, ec);
+		throw;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, edir, ec);
+	//other build stored the same entry meanwhile
+	if (ec) std::filesystem::remove_all(tmp, ec);
+}
+
+void ArtifactCache::storeFiles(const std::filesystem::path &tmp, const std::vector<std::filesystem::path> &files,
+		const std::vector<std::string> &rels) {
+	std::set<std::filesystem::path> dirs;
+	for (const auto &r: rels) dirs.insert((tmp / "files" / r).parent_path());
+	for (const auto &d: dirs) std::filesystem::create_directories(d);
+	std::vector<Job> jobs;
+	for (std::size_t i = 0; i < rels.size(); i++) {
+		jobs.push_back([&, i]{
+			std::filesystem::copy_file(files[i], tmp / "files" / rels[i], std::filesystem::copy_options::overwrite_existing);
+		});
+	}
+	runParallel(jobs);
+	{
+		std::ofstream manifest(tmp / "manifest", std::ios::out|std::ios::trunc);
+		for (const auto &r: rels) manifest << r << std::endl;
+		if (!manifest) throw std::runtime_error((tmp / "manifest").string() + ": failed to write");
+	}
+}
+
+std::string ArtifactCache::digestFile(const std::filesystem::path &file) {
+	std::ifstream in(file, std::ios::in|std::ios::binary);
+	if (!in) return std::string();
+	Sha256 digest;
+	char buff[4096];
+	in.read(buff, sizeof(buff));
+	auto sz = in.gcount();
+	while (sz) {
+		digest.update(std::string_view(buff, sz));
+		in.read(buff, sizeof(buff));
+		sz = in.gcount();
+	}
+	return digest.hex();
+}
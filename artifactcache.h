@@ -0,0 +1,54 @@
+/*
+ * artifactcache.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef ARTIFACTCACHE_H_
+#define ARTIFACTCACHE_H_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+///Shared cache of the build outputs
+/**
+ * Outputs are stored under the fingerprint of all inputs of the build. The cache directory
+ * can be shared between machines (for example NFS). Entries are written to a temporary
+ * directory and renamed, so a reader never sees an incomplete entry
+ */
+class ArtifactCache {
+public:
+
+	ArtifactCache(const std::filesystem::path &dir):dir(dir) {}
+
+	///Restores outputs of the build
+	/**
+	 * @param fingerprint fingerprint of the build
+	 * @param base directory where outputs are restored
+	 * @retval true restored
+	 * @retval false not found, or the entry is damaged or invalid
+	 */
+	bool restore(const std::string &fingerprint, const std::filesystem::path &base) const;
+	///Stores outputs of the build
+	/**
+	 * @param fingerprint fingerprint of the build
+	 * @param base directory of the outputs
+	 * @param files list of the outputs
+	 */
+	void store(const std::string &fingerprint, const std::filesystem::path &base,
+			const std::vector<std::filesystem::path> &files) const;
+
+	///Calculates SHA-256 digest of the file content, returns empty string when file can't be read
+	static std::string digestFile(const std::filesystem::path &file);
+
+protected:
+	std::filesystem::path dir;
+
+	std::filesystem::path entry(const std::string &fingerprint) const;
+	static void storeFiles(const std::filesystem::path &tmp, const std::vector<std::filesystem::path> &files,
+			const std::vector<std::string> &rels);
+};
+
+#endif /* ARTIFACTCACHE_H_ */
@@ -8,14 +8,31 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
 #include "linux_spawn.h"
+#include "artifactcache.h"
 #include "builder.h"
+#include "json.h"
+#include "sha256.h"
+#include "parallel.h"
 
 #include <thread>
 void Builder::parse(const std::filesystem::path &fname) {
 
 
-	parse(std::move(fname), std::vector<std::filesystem::path>());
+	parse(paths.intern(fname));
+	//resources which are not parsed are downloaded all together
+	std::vector<Job> jobs;
+	for (const auto &[target, source]: downloads) {
+		jobs.push_back([&, source = source, target = target]{download(source, target);});
+	}
+	runParallel(jobs);
+	downloads.clear();
+	//styles can be scanned after they are downloaded
+	for (Resource r: resources[cont_style]) scanStyle(r);
 
 }
 
@@ -25,20 +42,25 @@ static std::string_view trim(std::string_view str) {
 	return str;
 }
 
-void Builder::parse(const std::filesystem::path &fname,
-		std::vector<std::filesystem::path> &&recurse) {
+void Builder::parse(Resource fname) {
 
-	if (std::find(recurse.begin(), recurse.end(), fname) != recurse.end()) return;
-	std::ifstream f(fname, std::ios::in);
-	auto dirname = fname.parent_path();
-	recurse.push_back(fname);
+	if (visited.size() <= fname) visited.resize(fname+1, false);
+	if (visited[fname]) return;
+	visited[fname] = true;
+	std::ifstream f(paths[fname], std::ios::in);
+	auto dirname = paths[fname].parent_path();
 
-	if (!f) throw std::runtime_error("Can't open file: "+fname.string());
+	if (!f) throw std::runtime_error("Can't open file: "+paths[fname].string());
 
+	//styles declared next to an initial html fragment are needed for the first paint
+	ResourceList file_styles;
+	bool has_html = false;
+	Conditions cond(*this, paths[fname]);
 
 	while (!f.eof()) {
 		std::getline(f, buffer);
 		std::string_view ln(buffer);
+		if (cond.process(ln) || !cond.enabled()) continue;
 		if (ln.length()>3 && ln.substr(0,3) == "//@") {
 			ln = trim(ln.substr(3));
 			auto np = ln.find(' ');
@@ -51,14 +73,40 @@ void Builder::parse(const std::filesystem::path &fname,
 				args = trim(ln.substr(np+1));
 			}
 			if (cmd == "require") {
-				auto s = prepare(dirname , args);
-				parse(std::move(s), std::move(recurse));
+				auto s = prepare(dirname , args, false);
+				imports[fname].push_back(s);
+				parse(s);
 			} else if (cmd == "html") {
 				resources[cont_html].push_back(prepare(dirname , args));
+				has_html = true;
 			} else if (cmd == "template") {
-				resources[cont_htmltemplate].push_back(prepare(dirname , args));
+				bool inl = false;
+				std::string_view bundle = "templates";
+				if (args.substr(0,7) == "inline ") {
+					inl = true;
+					args = trim(args.substr(7));
+				} else if (!args.empty() && args[0] == '@') {
+					auto sp = args.find(' ');
+					if (sp == args.npos) throw std::runtime_error(paths[fname].string()+": missing template file");
+					bundle = args.substr(1, sp-1);
+					args = trim(args.substr(sp+1));
+				}
+				auto s = prepare(dirname , args);
+				if (inl) inline_templates.insert(s);
+				else template_bundle[s] = bundle;
+				resources[cont_htmltemplate].push_back(s);
+			} else if (cmd == "preload") {
+				preload_bundles.insert(std::string(args));
 			} else if (cmd == "style") {
-				resources[cont_style].push_back(prepare(dirname , args));
+				bool crit = false;
+				if (args.substr(0,9) == "critical ") {
+					crit = true;
+					args = trim(args.substr(9));
+				}
+				auto s = prepare(dirname , args);
+				if (crit) critical.insert(s);
+				file_styles.push_back(s);
+				resources[cont_style].push_back(s);
 			} else if (cmd == "image") {
 				resources[cont_image].push_back(prepare(dirname , args));
 			} else if (cmd == "file") {
@@ -80,9 +128,45 @@ void Builder::parse(const std::filesystem::path &fname,
 			}
 		}
 	}
+	cond.finish();
+	if (has_html) critical.insert(file_styles.begin(), file_styles.end());
 	resources[cont_script].push_back(fname);
 }
 
+bool Builder::isEnabled(std::string_view flag) const {
+	flag = trim(flag);
+	if (!flag.empty() && flag[0] == '!') return !isEnabled(flag.substr(1));
+	auto iter = defines.find(flag);
+	if (iter == defines.end()) return false;
+	return !iter->second.empty() && iter->second != "0" && iter->second != "false";
+}
+
+bool Builder::Conditions::process(std::string_view ln) {
+	ln = trim(ln);
+	if (ln.substr(0,3) != "//@") return false;
+	ln = trim(ln.substr(3));
+	if (ln.substr(0,3) == "if " || ln.substr(0,3) == "if\t") {
+		bool c = owner.isEnabled(ln.substr(3));
+		bool p = enabled();
+		stack.push_back({p, c, false, p && c});
+	} else if (ln == "else") {
+		if (stack.empty() || stack.back().in_else) throw std::runtime_error(fname.string()+": unexpected //@else");
+		Block &b = stack.back();
+		b.in_else = true;
+		b.active = b.parent && !b.cond;
+	} else if (ln == "endif") {
+		if (stack.empty()) throw std::runtime_error(fname.string()+": unexpected //@endif");
+		stack.pop_back();
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void Builder::Conditions::finish() const {
+	if (!stack.empty()) throw std::runtime_error(fname.string()+": missing //@endif");
+}
+
 static void to_hex(std::size_t h, std::string &b, int cnt) {
 	static const char symb[] = "0123456789ABCDEF";
 	if (cnt) {
@@ -96,6 +180,221 @@ static void to_hex(std::size_t h, std::string &b) {
 	to_hex(h, b, 16);
 }
 
+namespace {
+
+///Reference to other file found in a style
+struct CssRef {
+	std::size_t begin;
+	std::size_t end;
+	std::string ref;
+	bool import;
+	std::string media;
+};
+
+}
+
+static std::size_t parseCssUrl(std::string_view css, std::size_t p, std::string &ref) {
+	//p points after "url("
+	while (p < css.size() && isspace(css[p])) p++;
+	if (p < css.size() && (css[p] == '"' || css[p] == '\'')) {
+		char q = css[p++];
+		auto e = css.find(q, p);
+		if (e == css.npos) return css.npos;
+		ref = css.substr(p, e-p);
+		p = e+1;
+	} else {
+		auto e = css.find(')', p);
+		if (e == css.npos) return css.npos;
+		ref = trim(css.substr(p, e-p));
+		p = e;
+	}
+	auto e = css.find(')', p);
+	if (e == css.npos) return css.npos;
+	return e+1;
+}
+
+static std::vector<CssRef> findCssRefs(std::string_view css) {
+	std::vector<CssRef> res;
+	std::size_t p = 0;
+	while (p < css.size()) {
+		if (css.substr(p,2) == "/*") {
+			auto e = css.find("*/", p+2);
+			if (e == css.npos) break;
+			p = e+2;
+		} else if (css.substr(p,7) == "@import") {
+			CssRef r;
+			r.begin = p;
+			r.import = true;
+			p+=7;
+			while (p < css.size() && isspace(css[p])) p++;
+			if (css.substr(p,4) == "url(") {
+				p = parseCssUrl(css, p+4, r.ref);
+			} else if (p < css.size() && (css[p] == '"' || css[p] == '\'')) {
+				char q = css[p++];
+				auto e = css.find(q, p);
+				if (e != css.npos) {
+					r.ref = css.substr(p, e-p);
+					p = e+1;
+				} else {
+					p = e;
+				}
+			}
+			if (p == css.npos) break;
+			auto e = css.find(';', p);
+			if (e == css.npos) break;
+			r.media = trim(css.substr(p, e-p));
+			r.end = e+1;
+			p = e+1;
+			res.push_back(std::move(r));
+		} else if ((css[p] == 'u' || css[p] == 'U') && (css.substr(p,4) == "url(" || css.substr(p,4) == "URL(")) {
+			CssRef r;
+			r.begin = p;
+			r.import = false;
+			p = parseCssUrl(css, p+4, r.ref);
+			if (p == css.npos) break;
+			r.end = p;
+			res.push_back(std::move(r));
+		} else {
+			p++;
+		}
+	}
+	return res;
+}
+
+///Returns ?query or #fragment of the url, or empty string
+static std::string_view urlSuffix(std::string_view ref) {
+	auto q = ref.find_first_of("?#");
+	return q == ref.npos?std::string_view():ref.substr(q);
+}
+
+static std::string base64(const std::string &data) {
+	static const char symb[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string res;
+	res.reserve((data.size()+2)/3*4);
+	std::size_t i = 0;
+	for (; i+2 < data.size(); i+=3) {
+		unsigned int v = (static_cast<unsigned char>(data[i]) << 16) | (static_cast<unsigned char>(data[i+1]) << 8) | static_cast<unsigned char>(data[i+2]);
+		res.push_back(symb[(v >> 18) & 0x3F]);
+		res.push_back(symb[(v >> 12) & 0x3F]);
+		res.push_back(symb[(v >> 6) & 0x3F]);
+		res.push_back(symb[v & 0x3F]);
+	}
+	if (i < data.size()) {
+		unsigned int v = static_cast<unsigned char>(data[i]) << 16;
+		if (i+1 < data.size()) v |= static_cast<unsigned char>(data[i+1]) << 8;
+		res.push_back(symb[(v >> 18) & 0x3F]);
+		res.push_back(symb[(v >> 12) & 0x3F]);
+		res.push_back(i+1 < data.size()?symb[(v >> 6) & 0x3F]:'=');
+		res.push_back('=');
+	}
+	return res;
+}
+
+static const char *mimeType(const std::filesystem::path &p) {
+	auto ext = p.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c){return std::tolower(c);});
+	if (ext == ".png") return "image/png";
+	if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+	if (ext == ".gif") return "image/gif";
+	if (ext == ".svg") return "image/svg+xml";
+	if (ext == ".webp") return "image/webp";
+	if (ext == ".avif") return "image/avif";
+	if (ext == ".ico") return "image/x-icon";
+	if (ext == ".woff") return "font/woff";
+	if (ext == ".woff2") return "font/woff2";
+	if (ext == ".ttf") return "font/ttf";
+	if (ext == ".otf") return "font/otf";
+	if (ext == ".eot") return "application/vnd.ms-fontobject";
+	return "application/octet-stream";
+}
+
+bool Builder::resolveRef(Resource rs, std::string_view ref, Resource &res) {
+	if (ref.empty() || ref[0] == '/' || ref[0] == '#') return false;
+	if (ref.substr(0,5) == "data:" || ref.find("://") != ref.npos) return false;
+	auto q = ref.find_first_of("?#");
+	if (q != ref.npos) ref = ref.substr(0, q);
+	auto p = (paths[rs].parent_path() / ref).lexically_normal();
+	if (!std::filesystem::is_regular_file(p)) {
+		std::cerr << paths[rs].string() << ": referenced file not found: " << p.string() << std::endl;
+		return false;
+	}
+	res = paths.intern(p);
+	return true;
+}
+
+void Builder::scanStyle(Resource rs) {
+	if (!scanned_styles.insert(rs).second) return;
+	for (const CssRef &r: findCssRefs(content(rs, true))) {
+		Resource asset;
+		if (!resolveRef(rs, r.ref, asset)) continue;
+		if (css_assets.insert(asset).second) resources[cont_cssasset].push_back(asset);
+		if (r.import) scanStyle(asset);
+		else if (!urlSuffix(r.ref).empty()) css_suffixed_assets.insert(asset);
+	}
+}
+
+void Builder::prepareAssets(std::vector<std::pair<std::filesystem::path, std::filesystem::path> > &copies, const std::filesystem::path &assetdir) {
+	for (Resource r: resources[cont_cssasset]) {
+		const auto &p = paths[r];
+		if (p.extension() == ".css") continue;
+		std::error_code ec;
+		if (std::filesystem::file_size(p, ec) <= data_uri_limit
+				&& css_suffixed_assets.find(r) == css_suffixed_assets.end()) continue;
+		auto iter = asset_names.find(r);
+		if (iter == asset_names.end()) {
+			iter = asset_names.emplace(r, p.stem().string()+"."+fileDigest(r).substr(0,10)+p.extension().string()).first;
+		}
+		copies.emplace_back(p, assetdir / iter->second);
+	}
+}
+
+void Builder::rewriteStyle(Resource rs, const std::string &css, std::vector<Resource> &stack, StyleParts &parts) {
+	stack.push_back(rs);
+	std::string out;
+	//content of other file is stored as separate part, so the report attributes it to its source
+	auto flush = [&]{
+		if (!out.empty()) parts.emplace_back(rs, std::move(out));
+		out.clear();
+	};
+	std::size_t pos = 0;
+	for (const CssRef &r: findCssRefs(css)) {
+		Resource asset;
+		if (!resolveRef(rs, r.ref, asset)) continue;
+		auto iter = asset_names.find(asset);
+		auto suffix = urlSuffix(r.ref);
+		std::error_code ec;
+		//asset without name (not copied) keeps the original url when it is large or has a suffix
+		if (!r.import && iter == asset_names.end()
+				&& (!suffix.empty() || std::filesystem::file_size(paths[asset], ec) > data_uri_limit)) continue;
+		out.append(css, pos, r.begin - pos);
+		pos = r.end;
+		if (r.import) {
+			//imported style is inlined, it saves one round trip
+			if (std::find(stack.begin(), stack.end(), asset) != stack.end()) continue;
+			if (!r.media.empty()) out.append("@media ").append(r.media).append("{\n");
+			flush();
+			rewriteStyle(asset, content(asset, true), stack, parts);
+			if (!r.media.empty()) out.append("}\n");
+			continue;
+		}
+		if (iter != asset_names.end()) {
+			out.append("url(\"assets/").append(iter->second).append(suffix).append("\")");
+		} else {
+			std::ifstream in(paths[asset], std::ios::in|std::ios::binary);
+			std::ostringstream buff;
+			buff << in.rdbuf();
+			flush();
+			out.append("url(\"data:").append(mimeType(paths[asset])).append(";base64,")
+				.append(base64(buff.str())).append("\")");
+			parts.emplace_back(asset, std::move(out));
+			out.clear();
+		}
+	}
+	out.append(css, pos, css.npos);
+	flush();
+	stack.pop_back();
+}
+
 std::filesystem::path Builder::make_cache_file(const std::string_view &fname) const {
 	std::hash<std::string_view> h;
 	to_hex(h(fname), buffer);
@@ -106,18 +405,19 @@ std::filesystem::path Builder::make_cache_file(const std::string_view &fname) co
 	return cpath;
 }
 
-std::filesystem::path Builder::prepare(const std::filesystem::path &dir, const std::string_view &fname) {
+Builder::Resource Builder::prepare(const std::filesystem::path &dir, const std::string_view &fname, bool defer) {
 	if (fname.empty()) throw std::runtime_error("empty reference");
-	if (fname[0] == '/') return fname;
+	if (fname[0] == '/') return paths.intern(fname);
 	if (fname.substr(0,7)=="http://" || fname.substr(0,8)=="https://") {
 		std::string tmp ( fname);
 		auto cpath = make_cache_file(tmp);
 		if (!std::filesystem::exists(cpath)) {
-			download(tmp, cpath);
+			if (defer) downloads.emplace(cpath, tmp);
+			else download(tmp, cpath);
 		}
-		return cpath;
+		return paths.intern(cpath);
 	}
-	return dir / fname;
+	return paths.intern(dir / fname);
 
 }
 
@@ -129,10 +429,33 @@ void Builder::download(const std::string &source, const std::filesystem::path &t
 	if (i) throw std::runtime_error("Failed to download: "+source+" error:"+ std::to_string(i));
 }
 
+void Builder::build(const std::vector<Variant> &variants) {
+	std::string doc_lang = lang;
+	for (const Variant &v: variants) {
+		lang = v.lang.empty()?doc_lang:v.lang;
+		build(v.out, v.bt);
+	}
+	lang = doc_lang;
+}
+
 void Builder::build(const std::filesystem::path &out, BuildType bt) {
 	auto parent = out.parent_path();
 
+	//develop pages refer sources, report needs emission of the content
+	std::string fp;
+	if (!artifactCache.empty() && !report
+			&& bt != BuildType::develop_page && bt != BuildType::develop_page_symlink) {
+		fp = fingerprint(out, bt);
+		if (ArtifactCache(artifactCache).restore(fp, parent)) {
+			std::cout << "Restored from cache: " << fp << std::endl;
+			return;
+		}
+	}
+	produced.clear();
+
+	bundling = template_bundles && (bt == BuildType::std_page || bt == BuildType::critical_page || bt == BuildType::es_modules);
 	auto nsset_file = createNSSet(out);
+	produce(nsset_file);
 
 	std::filesystem::path pagefile = out;
 	pagefile.replace_extension(".html");
@@ -143,80 +466,258 @@ void Builder::build(const std::filesystem::path &out, BuildType bt) {
 	std::filesystem::path imgdir = out.parent_path() / "img";
 	std::filesystem::path filedir = out.parent_path() / "files";
 	std::filesystem::path confdir = out.parent_path() / "conf";
+	std::filesystem::path assetdir = out.parent_path() / "assets";
+	std::filesystem::path moddir;
+	std::unordered_map<Resource, std::string> modnames;
+
+	std::vector<Job> jobs;
 
 	switch (bt) {
-	case BuildType::script_only: {
+	case BuildType::script_only: jobs.push_back([&]{
 			std::ofstream fout(scriptfile, std::ios::out| std::ios::trunc);
-			buildScript(nsset_file, fout);
+			buildScript(nsset_file, fout, scriptfile);
 			checkFile(fout, scriptfile);
-		} break;
-	case BuildType::html_only: {
+		});break;
+	case BuildType::html_only: jobs.push_back([&]{
 			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
-			buildPage(fout, [&]{linkStyle(fout,out,stylefile);}, [&]{linkScript(fout, out, scriptfile);});
+			buildPage(fout, pagefile, [&]{linkStyle(fout,out,stylefile);}, [&]{linkScript(fout, out, scriptfile);});
 			checkFile(fout, pagefile);
-		} break;
-	case BuildType::single_page_file: {
+		});break;
+	case BuildType::single_page_file: jobs.push_back([&]{
 			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
-			buildPage(fout, [&]{
+			buildPage(fout, pagefile, [&]{
 				fout << "<style type=\"text/css\">" << std::endl;
-				buildStyle(fout);
+				buildStyle(fout, pagefile);
 				fout << "</style>";
 			} , [&]{
 				fout << "<script type=\"text/javascript\">" << std::endl;
-				buildScript(nsset_file, fout);
+				buildScript(nsset_file, fout, pagefile);
 				fout << "</script>";
 			});
 			checkFile(fout, pagefile);
-		} break;
-	case BuildType::std_page: {
+		});break;
+	case BuildType::std_page: jobs.push_back([&]{
 			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
-			buildPage(fout, [&]{linkStyle(fout,out,stylefile);}, [&]{linkScript(fout, out,scriptfile);});
+			buildPage(fout, pagefile, [&]{linkStyle(fout,out,stylefile);}, [&]{linkScript(fout, out,scriptfile);});
 			checkFile(fout, pagefile);
-		}{
-            std::filesystem::path srcmap = scriptfile;
-            srcmap.replace_extension(".map");
+		});jobs.push_back([&]{
             std::ofstream fout(scriptfile, std::ios::out| std::ios::trunc);
-            buildScript(nsset_file, fout);
+            buildScript(nsset_file, fout, scriptfile);
             checkFile(fout, scriptfile);
-        }{
+        });jobs.push_back([&]{
 			std::ofstream fout(stylefile, std::ios::out| std::ios::trunc);
-			buildStyle(fout);
+			buildStyle(fout, stylefile);
 			checkFile(fout, stylefile);
-		}
+		});
+		break;
+
+	case BuildType::critical_page: jobs.push_back([&]{
+			//the stylesheet contains all styles including critical, so the cascade is
+			//in the source order once it is loaded
+			std::ostringstream script, style;
+			runParallel({
+				[&]{buildScript(nsset_file, script, scriptfile);},
+				[&]{buildStyle(style, stylefile);}
+			});
+			auto scriptData = script.str();
+			auto styleData = style.str();
+			bool inlineScript = scriptData.size() < inline_limit;
+			bool inlineStyle = styleData.size() < inline_limit;
+			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
+			buildPage(fout, pagefile, [&]{
+				std::ostringstream head;
+				if (inlineStyle) head << styleData;
+				else buildCriticalStyle(head, pagefile);
+				auto headData = head.str();
+				if (!headData.empty()) {
+					fout << "<style type=\"text/css\">" << std::endl << headData << "</style>";
+				}
+				if (!inlineStyle) linkStyleAsync(fout, out, stylefile);
+				if (!inlineScript) preloadScript(fout, out, scriptfile);
+			}, [&]{
+				if (inlineScript) {
+					fout << "<script type=\"text/javascript\">" << std::endl << scriptData << "</script>";
+				} else {
+					linkScript(fout, out, scriptfile);
+				}
+			});
+			checkFile(fout, pagefile);
+			if (report) {
+				if (inlineScript) report->move(scriptfile, pagefile);
+				if (inlineStyle) report->move(stylefile, pagefile);
+			}
+			if (!inlineScript) {
+				std::ofstream fout(scriptfile, std::ios::out| std::ios::trunc);
+				fout << scriptData;
+				checkFile(fout, scriptfile);
+			}
+			if (!inlineStyle) {
+				std::ofstream fout(stylefile, std::ios::out| std::ios::trunc);
+				fout << styleData;
+				checkFile(fout, stylefile);
+			}
+		});break;
+
+	case BuildType::es_modules:
+		moddir = out.parent_path() / (out.stem().string()+".modules");
+		moduleNames(moddir, modnames);
+		jobs.push_back([&]{
+			buildModules(moddir, modnames);
+		});jobs.push_back([&]{
+			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
+			buildPage(fout, pagefile, [&]{
+				linkStyle(fout,out,stylefile);
+				for (const Resource &res: resources[cont_script]) {
+					linkModule(fout, out, moddir / modnames.at(res), true);
+				}
+			}, [&]{
+				linkScript(fout, out, nsset_file);
+				if (!resources[cont_script].empty()) {
+					linkModule(fout, out, moddir / modnames.at(resources[cont_script].back()), false);
+				}
+			});
+			checkFile(fout, pagefile);
+		});jobs.push_back([&]{
+			std::ofstream fout(stylefile, std::ios::out| std::ios::trunc);
+			buildStyle(fout, stylefile);
+			checkFile(fout, stylefile);
+		});
 		break;
 
 	case BuildType::develop_page_symlink:
-	case BuildType::develop_page: {
+	case BuildType::develop_page: jobs.push_back([&]{
+	    //links are local to this variant, shared resources stay unchanged
+	    std::unordered_map<Resource, std::filesystem::path> links;
 	    if (bt == BuildType::develop_page_symlink) {
-	        symlink_all_resources(pagefile);
+	        symlink_all_resources(pagefile, links);
 	    }
+	    auto link = [&](Resource res) -> const std::filesystem::path & {
+	        auto iter = links.find(res);
+	        return iter == links.end()?paths[res]:iter->second;
+	    };
 			std::ofstream fout(pagefile, std::ios::out| std::ios::trunc);
-			buildPage(fout, [&]{
+			buildPage(fout, pagefile, [&]{
 				for (const Resource &res: resources[cont_style]) {
-					linkStyle(fout, out, res);
+					linkStyle(fout, out, link(res));
 				}
 			} , [&]{
 				linkScript(fout, out, nsset_file);
 				for (const Resource &res: resources[cont_script]) {
-					linkScript(fout, out, res);
+					linkScript(fout, out, link(res));
 				}
 			});
 			checkFile(fout, pagefile);
-			}
+			});
 		break;
 	}
 
+	if (bundling) {
+		for (const auto &[name, templates]: templateBundles()) {
+			jobs.push_back([&, name = name, templates = templates]{
+				auto bundlefile = templateBundleFile(out, name);
+				std::ofstream fout(bundlefile, std::ios::out| std::ios::trunc);
+				buildTemplateBundle(fout, bundlefile, templates);
+				checkFile(fout, bundlefile);
+			});
+		}
+	}
 
+	std::vector<std::pair<std::filesystem::path, std::filesystem::path> > copies;
 	for (const Resource &res: resources[cont_image]) {
-		copyNewer(res, imgdir/res.filename());
+		copies.emplace_back(paths[res], imgdir/paths[res].filename());
 	}
 	for (const Resource &res: resources[cont_file]) {
-		copyNewer(res, filedir/res.filename());
+		copies.emplace_back(paths[res], filedir/paths[res].filename());
 	}
 	for (const Resource &res: resources[cont_config]) {
-		copyNewer(res, confdir/res.filename());
+		copies.emplace_back(paths[res], confdir/paths[res].filename());
+	}
+	if (bt == BuildType::std_page || bt == BuildType::single_page_file
+			|| bt == BuildType::critical_page || bt == BuildType::es_modules) {
+		prepareAssets(copies, assetdir);
+	}
+	copyNewer(copies, jobs);
+
+	runParallel(jobs);
+
+	if (!fp.empty()) {
+		std::sort(produced.begin(), produced.end());
+		ArtifactCache(artifactCache).store(fp, parent, produced);
+	}
+}
+
+std::string Builder::fingerprint(const std::filesystem::path &out, BuildType bt) {
+	//paths are relative to the output, so the fingerprint doesn't depend on the location of the checkout
+	Sha256 digest;
+	digest.field("spamake-2");
+	digest.field(std::to_string(static_cast<int>(bt)));
+	digest.field(out.filename().string());
+	digest.field(lang);
+	digest.field(std::to_string(inline_limit));
+	digest.field(std::to_string(data_uri_limit));
+	digest.field(template_bundles?"bundles":"inline");
+	for (const auto &[name, value]: defines) {
+		digest.field(name);
+		digest.field(value);
+	}
+	for (unsigned int i = 0; i < cont_count; i++) {
+		digest.field(std::to_string(i));
+		for (Resource r: resources[i]) {
+			digest.field(createRelativePath(out, r));
+			//text sources are hashed from the cached content, they are read only once
+			if (i == cont_script || i == cont_style) {
+				const std::string &data = content(r, true);
+				digest.field(&data == &empty_content?"<missing>":data);
+			} else if (i == cont_html || i == cont_pagehdr || i == cont_htmltemplate) {
+				const std::string &data = content(r, false);
+				digest.field(&data == &empty_content?"<missing>":data);
+			} else {
+				digest.field(fileDigest(r));
+			}
+		}
+	}
+	return digest.hex();
+}
+
+const std::string &Builder::fileDigest(Resource rs) {
+	{
+		std::lock_guard _(content_lock);
+		auto iter = file_digests.find(rs);
+		if (iter != file_digests.end()) return iter->second;
+	}
+	std::string d = ArtifactCache::digestFile(paths[rs]);
+	if (d.empty()) d = "<missing>";
+	std::lock_guard _(content_lock);
+	return file_digests.emplace(rs, std::move(d)).first->second;
+}
+
+std::map<std::string, Builder::ResourceList> Builder::templateBundles() const {
+	std::map<std::string, ResourceList> res;
+	Modules used;
+	for (Resource r: resources[cont_htmltemplate]) {
+		if (inline_templates.find(r) != inline_templates.end()) continue;
+		if (!used.insert(r).second) continue;
+		res[template_bundle.at(r)].push_back(r);
 	}
+	return res;
+}
+
+std::filesystem::path Builder::templateBundleFile(const std::filesystem::path &out_name, const std::string &bundle) {
+	return out_name.parent_path()/(out_name.stem().string()+"."+bundle+".json");
+}
 
+void Builder::buildTemplateBundle(std::ostream &out, const std::filesystem::path &target, const ResourceList &templates) {
+	out << "{";
+	for (Resource r: templates) {
+		if (r != templates.front()) out << ",";
+		out << std::endl;
+		const std::string &data = content(r, false);
+		writeJSONString(out, paths[r].stem().string());
+		out << ":";
+		writeJSONString(out, data);
+		if (report) report->record(target, paths[r], data);
+	}
+	out << std::endl << "}" << std::endl;
 }
 
 std::filesystem::path Builder::createNSSet(const std::filesystem::path &out_name) const {
@@ -228,10 +729,74 @@ std::filesystem::path Builder::createNSSet(const std::filesystem::path &out_name
 		if (x.find('.') == x.npos) out << "var " << x << "={};" << std::endl;
 		else out << x << "={};" << std::endl;
 	}
+	auto bundles = bundling?templateBundles():std::map<std::string, ResourceList>();
+	if (!bundles.empty()) {
+		out << "var templateBundles={";
+		for (const auto &[name, templates]: bundles) {
+			if (name != bundles.begin()->first) out << ",";
+			writeJSONString(out, name);
+			out << ":";
+			writeJSONString(out, templateBundleFile(out_name, name).filename().string());
+		}
+		out << "};" << std::endl << "var templateIndex={";
+		bool first = true;
+		for (const auto &[name, templates]: bundles) {
+			for (Resource r: templates) {
+				if (!first) out << ",";
+				first = false;
+				writeJSONString(out, paths[r].stem().string());
+				out << ":";
+				writeJSONString(out, name);
+			}
+		}
+		out << "};" << std::endl;
+		out <<
+R"js(var templateNodes={};
+var templateSources={};
+var templateLoading={};
+function parseTemplateBundle(text){
+	var data = JSON.parse(text);
+	for (var k in data) templateSources[k] = data[k];
+};
+function loadTemplateBundle(bundle){
+	if (!templateLoading[bundle]) {
+		templateLoading[bundle] = fetch(templateBundles[bundle]).then(function(r){
+			if (!r.ok) throw new Error("Failed to load template bundle: "+bundle);
+			return r.text();
+		}).then(parseTemplateBundle).catch(function(e){
+			delete templateLoading[bundle];
+			throw e;
+		});
+	}
+	return templateLoading[bundle];
+};
+function findTemplate(name){
+	var nd = document.getElementById(name) || templateNodes[name];
+	if (nd || !templateIndex[name]) return nd;
+	if (templateSources[name] === undefined) {
+		console.warn("Template '"+name+"' used before its bundle has been loaded, loading synchronously. Use loadTemplateAsync()");
+		var req = new XMLHttpRequest();
+		req.open("GET", templateBundles[templateIndex[name]], false);
+		req.send();
+		parseTemplateBundle(req.responseText);
+	}
+	nd = document.createElement("template");
+	nd.innerHTML = templateSources[name];
+	delete templateSources[name];
+	templateNodes[name] = nd;
+	return nd;
+};
+function loadTemplateAsync(name){
+	if (!templateIndex[name] || templateNodes[name] || templateSources[name] !== undefined
+		|| document.getElementById(name)) return Promise.resolve(loadTemplate(name));
+	return loadTemplateBundle(templateIndex[name]).then(function(){return loadTemplate(name);});
+};
+)js";
+	}
 	if (!resources[cont_htmltemplate].empty()) {
 		out <<
 R"js(function loadTemplate(name){
-	var nd = document.getElementById(name);
+	var nd = )js" << (bundles.empty()?"document.getElementById(name)":"findTemplate(name)") << R"js(;
 	var el = document.importNode(nd.content, true);
 	if (el.firstElementChild && !el.firstElementChild.nextElementSibling) el = el.firstElementChild;
 	else return el;
@@ -258,16 +823,61 @@ function collectNamedElements(templnode){
 
 void Builder::checkFile(std::ostream &out, const std::filesystem::path &out_name) {
 	if (!out) throw std::runtime_error(out_name.string() + ": failed to write");
+	if (report) report->addOutput(out_name);
+	produce(out_name);
+}
+
+void Builder::produce(const std::filesystem::path &out_name) {
+	std::lock_guard _(produced_lock);
+	produced.push_back(out_name);
+}
+
+void Builder::copyNewer(const std::vector<std::pair<std::filesystem::path, std::filesystem::path> > &copies, std::vector<Job> &jobs) {
+	std::set<std::filesystem::path> dirs;
+	for (const auto &c: copies) dirs.insert(c.second.parent_path());
+	for (const auto &d: dirs) std::filesystem::create_directories(d);
+	//one job copies a batch of files, so huge asset trees don't create a job per file
+	constexpr std::size_t batch = 64;
+	for (std::size_t i = 0; i < copies.size(); i+=batch) {
+		jobs.push_back([this, &copies, i]{
+			std::size_t e = std::min(copies.size(), i+batch);
+			for (std::size_t j = i; j < e; j++) {
+				copyNewer(copies[j].first, copies[j].second);
+				produce(copies[j].second);
+			}
+		});
+	}
 }
 
 void Builder::copyNewer(const std::filesystem::path &from, 	const std::filesystem::path &to) {
-	std::filesystem::create_directories(to.parent_path());
-	std::error_code ec;
-	std::filesystem::file_time_type srcTime = std::filesystem::last_write_time(from);
-	std::filesystem::file_time_type trgTime = std::filesystem::last_write_time(to, ec);
-	if (srcTime > trgTime) {
+	struct stat srcst, trgst;
+	if (::stat(from.c_str(), &srcst)) throw std::runtime_error("Can't open file: "+from.string());
+	if (::stat(to.c_str(), &trgst) == 0) {
+		if (srcst.st_mtim.tv_sec < trgst.st_mtim.tv_sec) return;
+		if (srcst.st_mtim.tv_sec == trgst.st_mtim.tv_sec && srcst.st_mtim.tv_nsec <= trgst.st_mtim.tv_nsec) return;
+	}
+	copyFile(from, to, srcst);
+}
+
+void Builder::copyFile(const std::filesystem::path &from, const std::filesystem::path &to, const struct stat &srcst) {
+	ondra_shared::ExternalProcess::FD in(::open(from.c_str(), O_RDONLY|O_CLOEXEC));
+	ondra_shared::ExternalProcess::FD out(::open(to.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, srcst.st_mode & 07777));
+	if (in < 0 || out < 0) {
 		std::filesystem::copy_file(from,to, std::filesystem::copy_options::overwrite_existing);
+		return;
+	}
+	//reflink shares extents on copy-on-write filesystems (btrfs, xfs)
+	if (::ioctl(out, FICLONE, static_cast<int>(in)) == 0) return;
+	off_t remain = srcst.st_size;
+	while (remain > 0) {
+		auto r = ::copy_file_range(in, nullptr, out, nullptr, remain, 0);
+		if (r <= 0) break;
+		remain -= r;
 	}
+	if (remain == 0) return;
+	in.close();
+	out.close();
+	std::filesystem::copy_file(from,to, std::filesystem::copy_options::overwrite_existing);
 }
 
 void Builder::linkScript(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link) {
@@ -276,60 +886,60 @@ void Builder::linkScript(std::ostream &out, const std::filesystem::path &rel, co
 void Builder::linkStyle(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link) {
 	out << "<link rel=\"stylesheet\" href=\"" << createRelativePath(rel, link) << "\" />";
 }
+void Builder::linkStyleAsync(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link) {
+	auto href = createRelativePath(rel, link);
+	out << "<link rel=\"preload\" href=\"" << href << "\" as=\"style\" onload=\"this.onload=null;this.rel='stylesheet'\" />"
+		<< "<noscript><link rel=\"stylesheet\" href=\"" << href << "\" /></noscript>";
+}
+void Builder::linkModule(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link, bool preload) {
+	if (preload) out << "<link rel=\"modulepreload\" href=\"" << createRelativePath(rel, link) << "\" />";
+	else out << "<script type=\"module\" src=\"" << createRelativePath(rel, link) << "\"></script>";
+}
+void Builder::preloadScript(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link) {
+	out << "<link rel=\"preload\" href=\"" << createRelativePath(rel, link) << "\" as=\"script\" />";
+}
 
-std::string Builder::createRelativePath(const std::filesystem::path &rel, const std::filesystem::path &link) {
-	std::string res;
-	auto ir = rel.begin();
-	auto il = link.begin();
-	while (ir != rel.end() && il != link.end()) {
-		if (*ir == *il) {
-			++ir;
-			++il;
-		} else {
-			auto n = res.size();
-			while (ir != rel.end()) {
-				n = res.size();
-				res.append("../");
-				++ir;
-			}
-			res.resize(n);
-			break;
-		}
-	}
-	if (il != link.end()) {
-		while (il != link.end()) {
-			res.append(*il);
-			res.push_back('/');
-			++il;
-		}
-		res.pop_back();
-	} else {
-		res.append(link.filename());
-	}
+const std::string &Builder::createRelativePath(const std::filesystem::path &rel, const std::filesystem::path &link) {
+	return paths.relative(paths.intern(rel), paths.intern(link));
+}
 
-	return res;
+const std::string &Builder::createRelativePath(const std::filesystem::path &rel, Resource link) {
+	return paths.relative(paths.intern(rel), link);
 }
 
 
 template<typename StyleFN, typename ScriptFN>
-void Builder::buildPage(std::ostream &out, StyleFN &&stylefn, ScriptFN &&scriptfn) {
+void Builder::buildPage(std::ostream &out, const std::filesystem::path &target, StyleFN &&stylefn, ScriptFN &&scriptfn) {
 
 	out << "<!DOCTYPE html>";
 	if (lang.empty()) out <<"<HTML>";
 	else out << "<HTML lang=\"" << lang <<"\">";
 	out << "<HEAD><META charset=\"UTF-8\" />" ;
 	for (const Resource &rs: resources[cont_pagehdr]) {
-		insertFile(out, rs);
+		emit(out, target, rs, false);
+	}
+	if (bundling && !preload_bundles.empty()) {
+		auto bundles = templateBundles();
+		for (const auto &b: preload_bundles) {
+			if (bundles.find(b) == bundles.end()) {
+				std::cerr << "Preloaded template bundle not found: " << b << std::endl;
+				continue;
+			}
+			//crossorigin is required to match the request made by fetch()
+			out << "<link rel=\"preload\" href=\"" << createRelativePath(target, templateBundleFile(target, b))
+				<< "\" as=\"fetch\" crossorigin=\"anonymous\" />";
+		}
 	}
 
 	stylefn();
 	out << "</HEAD><BODY>";
 	for (const Resource &rs: resources[cont_html]) {
-		insertFile(out, rs);
+		emit(out, target, rs, false);
 	}
 	for (const Resource &rs: resources[cont_htmltemplate]) {
-		out << "<TEMPLATE id=" << rs.stem() << ">";
-		insertFile(out, rs);
+		if (bundling && inline_templates.find(rs) == inline_templates.end()) continue;
+		out << "<TEMPLATE id=" << paths[rs].stem() << ">";
+		emit(out, target, rs, false);
 		out << "</TEMPLATE>";
 	}
 	scriptfn();
@@ -337,85 +947,211 @@ void Builder::buildPage(std::ostream &out, StyleFN &&stylefn, ScriptFN &&scriptf
 
 }
 
-void Builder::insertFile(std::ostream &out, const std::filesystem::path &rs) {
+bool Builder::insertFile(std::ostream &out, const std::filesystem::path &rs) {
 	std::ifstream in(rs, std::ios::in);
-	if (!(!in)) {
-		char buff[4096];
-		in.read(buff, 4096);
-		auto sz = in.gcount();
-		while (sz) {
-			out.write(buff, sz);
-			in.read(buff, 4096);
-			sz = in.gcount();
-		}
-	}
+	if (!in) return false;
+	std::ostringstream buff;
+	buff << in.rdbuf();
 	if (in.bad()) throw std::runtime_error(rs.string() + ": failed to read file");
+	std::string data = buff.str();
+	if (data.find("//@") == data.npos) {
+		out << data;
+		return true;
+	}
+	Conditions cond(*this, rs);
+	std::string_view d(data);
+	while (!d.empty()) {
+		auto nl = d.find('\n');
+		auto ln = d.substr(0, nl == d.npos?d.npos:nl+1);
+		d = d.substr(ln.size());
+		if (!cond.process(ln) && cond.enabled()) out << ln;
+	}
+	cond.finish();
+	return true;
 }
 
-void Builder::buildScript(const std::filesystem::path &nsf, std::ostream &out) {
+void Builder::buildScript(const std::filesystem::path &nsf, std::ostream &out, const std::filesystem::path &target) {
 
-	insertScript(out, nsf);
+	emit(out, target, nsf, true);
 	for (const Resource &rs: resources[cont_script]) {
 		if (modules.find(rs) != modules.end()) {
 			out << "(function(){" << std::endl;
-			insertScript(out, rs);
+			emit(out, target, rs, true);
 			out << "})();";
 		} else {
-			insertScript(out, rs);
+			emit(out, target, rs, true);
+		}
+	}
+}
+
+void Builder::moduleNames(const std::filesystem::path &moddir, std::unordered_map<Resource, std::string> &names) {
+	std::set<std::string> used;
+	for (const Resource &rs: resources[cont_script]) {
+		std::string stem = paths[rs].stem().string();
+		std::string name = stem + ".js";
+		for (int i = 1; used.find(name) != used.end(); i++) {
+			name = stem + "_" + std::to_string(i) + ".js";
 		}
+		used.insert(name);
+		names.emplace(rs, name);
 	}
+	std::filesystem::remove_all(moddir);
+	std::filesystem::create_directories(moddir);
+}
+
+void Builder::buildModules(const std::filesystem::path &moddir, const std::unordered_map<Resource, std::string> &names) {
+	std::vector<Job> jobs;
+	for (const Resource &rs: resources[cont_script]) {
+		jobs.push_back([&, rs]{
+			auto modfile = moddir / names.at(rs);
+			std::ofstream out(modfile, std::ios::out| std::ios::trunc);
+			auto iter = imports.find(rs);
+			if (iter != imports.end()) {
+				for (const Resource &dep: iter->second) {
+					out << "import \"./" << names.at(dep) << "\";" << std::endl;
+				}
+			}
+			emit(out, modfile, rs, true);
+			checkFile(out, modfile);
+		});
+	}
+	runParallel(jobs);
 }
 
 Builder::Builder(const std::filesystem::path &cachePath):cachePath(cachePath) {
 }
 
-void Builder::buildStyle(std::ostream &out) {
+void Builder::buildStyle(std::ostream &out, const std::filesystem::path &target) {
 	for (const Resource &rs: resources[cont_style]) {
-		insertScript(out, rs);
+		emitStyle(out, target, rs);
 		out << std::endl;
 	}
 }
 
-void Builder::insertScript(std::ostream &out, const std::filesystem::path &rs) {
+void Builder::buildCriticalStyle(std::ostream &out, const std::filesystem::path &target) {
+	for (const Resource &rs: resources[cont_style]) {
+		if (critical.find(rs) != critical.end()) {
+			emitStyle(out, target, rs);
+			out << std::endl;
+		}
+	}
+}
+
+void Builder::emit(std::ostream &out, const std::filesystem::path &target, const std::filesystem::path &rs, bool script) {
+	if (!report) {
+		if (script) insertScript(out, rs); else insertFile(out, rs);
+		return;
+	}
+	std::ostringstream buff;
+	if (script) insertScript(buff, rs); else insertFile(buff, rs);
+	std::string data = buff.str();
+	out << data;
+	report->record(target, rs, data);
+}
+
+void Builder::emit(std::ostream &out, const std::filesystem::path &target, Resource rs, bool script) {
+	const std::string &data = content(rs, script);
+	out << data;
+	if (report) report->record(target, paths[rs], data);
+}
+
+void Builder::emitStyle(std::ostream &out, const std::filesystem::path &target, Resource rs) {
+	const StyleParts &parts = styleContent(rs);
+	for (const auto &p: parts) out << p.second;
+	if (!report) return;
+	//the same source can have multiple parts, it is reported once
+	StyleParts sources;
+	for (const auto &[src, data]: parts) {
+		auto iter = std::find_if(sources.begin(), sources.end(), [&, &src = src](const auto &s){return s.first == src;});
+		if (iter == sources.end()) sources.emplace_back(src, data);
+		else iter->second.append(data);
+	}
+	for (const auto &[src, data]: sources) report->record(target, paths[src], data);
+}
+
+const Builder::StyleParts &Builder::styleContent(Resource rs) {
+	{
+		std::lock_guard _(content_lock);
+		auto iter = style_cache.find(rs);
+		if (iter != style_cache.end()) return iter->second;
+	}
+	std::vector<Resource> stack;
+	const std::string &src = content(rs, true);
+	if (&src == &empty_content) return empty_style;
+	StyleParts parts;
+	rewriteStyle(rs, src, stack, parts);
+	std::lock_guard _(content_lock);
+	return style_cache.emplace(rs, std::move(parts)).first->second;
+}
+
+const std::string &Builder::content(Resource rs, bool script) {
+	auto &cache = content_cache[script?1:0];
+	{
+		std::lock_guard _(content_lock);
+		auto iter = cache.find(rs);
+		if (iter != cache.end()) return iter->second;
+	}
+	std::ostringstream buff;
+	bool ok = script?insertScript(buff, paths[rs]):insertFile(buff, paths[rs]);
+	//failed read is not cached, the file can appear later (download)
+	if (!ok) return empty_content;
+	std::lock_guard _(content_lock);
+	return cache.emplace(rs, buff.str()).first->second;
+}
+
+bool Builder::insertScript(std::ostream &out, const std::filesystem::path &rs) {
 	std::ifstream in(rs, std::ios::in);
     if (!in) {
         std::cerr << "Failed to open:" << rs << std::endl;
-        return;
+        return false;
     }
 
 	std::string ln;
+	Conditions cond(*this, rs);
 	while (!in.eof()) {
 	    std::getline(in, ln);
 	    std::string_view lnw(ln);
 	    while (!lnw.empty() && isspace(lnw.front())) lnw = lnw.substr(1);
+	    if (cond.process(lnw) || !cond.enabled()) continue;
 	    if (!lnw.empty() && lnw.substr(0,2) != "//") {
 	        out << lnw << std::endl;
 	    }
 	}
+	cond.finish();
+	return true;
 
 }
 
 void Builder::create_dep_file(const std::filesystem::path &depfile, const std::filesystem::path &output) {
+    create_dep_file(depfile, std::vector<std::filesystem::path>{output});
+}
+
+void Builder::create_dep_file(const std::filesystem::path &depfile, const std::vector<std::filesystem::path> &outputs) {
     std::ofstream depf(depfile);
-    depf << createRelativePath(depfile, output) << ":";
+    auto base = paths.intern(depfile);
+    for (const auto &output: outputs) {
+        if (&output != &outputs.front()) depf << " ";
+        depf << createRelativePath(depfile, output);
+    }
+    depf << ":";
     for (const auto &rl: resources) {
         for (const auto &r: rl) {
-            depf << " " << createRelativePath(depfile, r);
+            depf << " " << paths.relative(base, r);
         }
     }
     depf << std::endl;
 }
 
-void Builder::symlink_all_resources(const std::filesystem::path &pagefile) {
+void Builder::symlink_all_resources(const std::filesystem::path &pagefile, std::unordered_map<Resource, std::filesystem::path> &links) {
     constexpr unsigned int cats[] = {cont_script, cont_style};
     auto srcdir = pagefile.parent_path();
     auto trgdir = pagefile.parent_path()/"sources";
     std::filesystem::remove(trgdir);
     std::filesystem::path common = {};
     for (unsigned int x: cats) {
-        for (auto src : resources[x]) {
-            if (!std::filesystem::exists(src)) break;
-            src = src.parent_path();
+        for (auto res : resources[x]) {
+            if (!std::filesystem::exists(paths[res])) break;
+            auto src = paths[res].parent_path();
             if (common.empty()) common = src;
             else {
                 auto it1 = common.begin();
@@ -435,10 +1171,10 @@ void Builder::symlink_all_resources(const std::filesystem::path &pagefile) {
     std::cout << "Common folder: " << common << std::endl;
     std::filesystem::create_symlink(common, trgdir);
     for (unsigned int x: cats) {
-        for (auto &src : resources[x]) {
-            if (!std::filesystem::exists(src)) break;
-            auto r = createRelativePath(common, src);
-            src = trgdir / r;
+        for (auto res : resources[x]) {
+            if (!std::filesystem::exists(paths[res])) break;
+            auto src = trgdir / createRelativePath(common, res);
+            links[res] = src;
             std::cout << "Linked: " << src << std::endl;
         }
     }
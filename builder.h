@@ -8,9 +8,15 @@
 #ifndef BUILDER_H_
 #define BUILDER_H_
 
+#include <map>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #include <vector>
 #include <filesystem>
+#include "parallel.h"
+#include "pathtable.h"
+#include "report.h"
 
 enum class BuildType {
 	///build script only - ignore resources
@@ -24,7 +30,11 @@ enum class BuildType {
 	///generate html, but link resources to the page (developer mode)0
 	develop_page,
 	///develop page symlinked
-	develop_page_symlink
+	develop_page_symlink,
+	///generate standard 3 files, inline critical styles, load the rest asynchronously
+	critical_page,
+	///generate html, style and every script as native ES module
+	es_modules
 };
 
 class Builder {
@@ -40,20 +50,46 @@ public:
 	static const unsigned int cont_pagehdr=5;
 	static const unsigned int cont_htmltemplate=6;
 	static const unsigned int cont_config=7;
-	static const unsigned int cont_count=8;
+	static const unsigned int cont_cssasset=8;
+	static const unsigned int cont_count=9;
 
 
-	using Resource = std::filesystem::path;
+	using Resource = PathTable::ID;
 	using ResourceList = std::vector<Resource>;
 	using ContainerType = std::string;
 
 
 	void parse(const std::filesystem::path &fname);
-	void parse(const std::filesystem::path &fname, std::vector<std::filesystem::path> &&recurse);
 
 	void build(const std::filesystem::path &out, BuildType bt);
 
+	struct Variant {
+		BuildType bt;
+		std::filesystem::path out;
+		///overrides //@lang when it is not empty
+		std::string lang;
+	};
+
+	///Builds multiple variants from single parse. Content of sources is read only once
+	void build(const std::vector<Variant> &variants);
+
+	///Whole script bundle and whole style bundle smaller than this limit are inlined into the page (critical_page only)
+	void setInlineLimit(std::size_t limit) {inline_limit = limit;}
+	///Pack templates to separate bundles loaded on demand (page, critical, esm)
+	void setTemplateBundles(bool enable) {template_bundles = enable;}
+	///Assets referenced from styles smaller than this limit are inlined as data URI
+	void setDataURILimit(std::size_t limit) {data_uri_limit = limit;}
+	///Record composition of the outputs to the report
+	void setReport(BundleReport *rep) {report = rep;}
+	///Restore outputs from the shared cache when all inputs are same, store outputs otherwise
+	void setArtifactCache(const std::filesystem::path &dir) {artifactCache = dir;}
+	///Defines flag for //@if directive
+	void define(const std::string &name, const std::string &value) {defines[name] = value;}
+	///Returns true, when the flag is defined and its value is not empty, 0 or false. The flag can be negated by !
+	bool isEnabled(std::string_view flag) const;
+
     void create_dep_file(const std::filesystem::path &depfile, const std::filesystem::path &output);
+    void create_dep_file(const std::filesystem::path &depfile, const std::vector<std::filesystem::path> &outputs);
 
 
 
@@ -64,35 +100,112 @@ protected:
 
 	std::filesystem::path cachePath;
 
+	PathTable paths;
 	ResourceList resources[cont_count];
+	std::vector<bool> visited;
+	std::map<std::filesystem::path, std::string> downloads;
+	std::mutex content_lock;
+	///rewritten style split to parts by the source of the bytes (inlined imports and assets)
+	using StyleParts = std::vector<std::pair<Resource, std::string> >;
+	std::unordered_map<Resource, std::string> content_cache[2];
+	std::unordered_map<Resource, StyleParts> style_cache;
+	const std::string empty_content;
+	const StyleParts empty_style;
+	std::unordered_map<Resource, std::string> file_digests;
+	std::set<Resource> scanned_styles;
+	std::set<Resource> css_assets;
+	///assets referenced with ?query or #fragment, they can't be inlined as data URI
+	std::set<Resource> css_suffixed_assets;
+	std::unordered_map<Resource, std::string> asset_names;
 	mutable std::string buffer;
 
 	using NSSet = std::set<std::string>;
 	using Modules = std::set<Resource>;
 	NSSet nsset;
 	Modules modules;
+	Modules critical;
+	std::unordered_map<Resource, ResourceList> imports;
 	std::string lang;
-
-
-	std::filesystem::path prepare(const std::filesystem::path &dir, const std::string_view &fname);
+	std::map<std::string, std::string, std::less<> > defines;
+	std::size_t inline_limit = 4096;
+	std::size_t data_uri_limit = 2048;
+	bool template_bundles = false;
+	bool bundling = false;
+	Modules inline_templates;
+	std::unordered_map<Resource, std::string> template_bundle;
+	std::set<std::string> preload_bundles;
+	BundleReport *report = nullptr;
+	std::filesystem::path artifactCache;
+	std::mutex produced_lock;
+	std::vector<std::filesystem::path> produced;
+
+
+	void parse(Resource fname);
+	Resource prepare(const std::filesystem::path &dir, const std::string_view &fname, bool defer = true);
 	std::filesystem::path make_cache_file(const std::string_view &name_source) const;
 	void download(const std::string &source, const std::filesystem::path &target);
 	std::filesystem::path createNSSet(const std::filesystem::path &out_name) const;
+	std::map<std::string, ResourceList> templateBundles() const;
+	static std::filesystem::path templateBundleFile(const std::filesystem::path &out_name, const std::string &bundle);
+	void buildTemplateBundle(std::ostream &out, const std::filesystem::path &target, const ResourceList &templates);
 
 	void checkFile(std::ostream &out, const std::filesystem::path &out_name);
-	void copyNewer(const std::filesystem::path &from, const std::filesystem::path &to);
+	void produce(const std::filesystem::path &out_name);
+	std::string fingerprint(const std::filesystem::path &out, BuildType bt);
+	const std::string &fileDigest(Resource rs);
+	void copyNewer(const std::vector<std::pair<std::filesystem::path, std::filesystem::path> > &copies, std::vector<Job> &jobs);
+	static void copyNewer(const std::filesystem::path &from, const std::filesystem::path &to);
+	static void copyFile(const std::filesystem::path &from, const std::filesystem::path &to, const struct stat &srcst);
 	void linkScript(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link);
 	void linkStyle(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link);
-
-	static std::string createRelativePath(const std::filesystem::path &rel, const std::filesystem::path &link);
-	static void insertFile(std::ostream &out, const std::filesystem::path &rs);
+	void linkStyleAsync(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link);
+	void preloadScript(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link);
+
+	const std::string &createRelativePath(const std::filesystem::path &rel, const std::filesystem::path &link);
+	const std::string &createRelativePath(const std::filesystem::path &rel, Resource link);
+	///Tracks state of //@if, //@else and //@endif blocks in one file
+	class Conditions {
+	public:
+		Conditions(const Builder &owner, const std::filesystem::path &fname):owner(owner),fname(fname) {}
+		///Processes the line, returns true, when the line is a conditional directive
+		bool process(std::string_view ln);
+		///Returns true, when the current line is in enabled region
+		bool enabled() const {return stack.empty() || stack.back().active;}
+		///Checks that all blocks are closed
+		void finish() const;
+	protected:
+		struct Block {
+			bool parent;
+			bool cond;
+			bool in_else;
+			bool active;
+		};
+		const Builder &owner;
+		const std::filesystem::path &fname;
+		std::vector<Block> stack;
+	};
+
+	bool insertFile(std::ostream &out, const std::filesystem::path &rs);
 	template<typename StyleFN, typename ScriptFN>
-	void buildPage(std::ostream &out, StyleFN &&stylefn, ScriptFN &&scriptfn);
-	void buildScript( const std::filesystem::path &nsf, std::ostream &out); ///<returns source map mapping
-	void buildStyle(std::ostream &out);
-
-	void insertScript(std::ostream &out, const std::filesystem::path &rs);
-	void symlink_all_resources(const std::filesystem::path &pagefile);
+	void buildPage(std::ostream &out, const std::filesystem::path &target, StyleFN &&stylefn, ScriptFN &&scriptfn);
+	void buildScript( const std::filesystem::path &nsf, std::ostream &out, const std::filesystem::path &target); ///<returns source map mapping
+	void buildStyle(std::ostream &out, const std::filesystem::path &target);
+	void buildCriticalStyle(std::ostream &out, const std::filesystem::path &target);
+
+	bool insertScript(std::ostream &out, const std::filesystem::path &rs);
+	void emit(std::ostream &out, const std::filesystem::path &target, const std::filesystem::path &rs, bool script);
+	void emit(std::ostream &out, const std::filesystem::path &target, Resource rs, bool script);
+	const std::string &content(Resource rs, bool script);
+	void emitStyle(std::ostream &out, const std::filesystem::path &target, Resource rs);
+	const StyleParts &styleContent(Resource rs);
+	void rewriteStyle(Resource rs, const std::string &css, std::vector<Resource> &stack, StyleParts &parts);
+	void scanStyle(Resource rs);
+	bool resolveRef(Resource rs, std::string_view ref, Resource &res);
+	void prepareAssets(std::vector<std::pair<std::filesystem::path, std::filesystem::path> > &copies, const std::filesystem::path &assetdir);
+	void moduleNames(const std::filesystem::path &moddir, std::unordered_map<Resource, std::string> &names);
+	void buildModules(const std::filesystem::path &moddir, const std::unordered_map<Resource, std::string> &names);
+	void linkModule(std::ostream &out, const std::filesystem::path &rel, const std::filesystem::path &link, bool preload);
+	void symlink_all_resources(const std::filesystem::path &pagefile, std::unordered_map<Resource, std::filesystem::path> &links);
 
 };
 
@@ -0,0 +1,69 @@
+/*
+ * jobserver.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <poll.h>
+#include <cerrno>
+#include <memory>
+#include <string_view>
+#include "jobserver.h"
+
+JobServer *JobServer::instance() {
+	static std::unique_ptr<JobServer> inst(create(getenv("MAKEFLAGS")));
+	return inst.get();
+}
+
+JobServer *JobServer::create(const char *makeflags) {
+	if (makeflags == nullptr) return nullptr;
+	std::string_view flags(makeflags);
+	std::string_view auth;
+	std::size_t pos = 0;
+	while (pos < flags.size()) {
+		auto sp = flags.find(' ', pos);
+		if (sp == flags.npos) sp = flags.size();
+		auto w = flags.substr(pos, sp - pos);
+		//the last one wins, older make uses --jobserver-fds
+		if (w.substr(0,17) == "--jobserver-auth=") auth = w.substr(17);
+		else if (w.substr(0,16) == "--jobserver-fds=") auth = w.substr(16);
+		pos = sp+1;
+	}
+	if (auth.empty()) return nullptr;
+
+	if (auth.substr(0,5) == "fifo:") {
+		std::string path(auth.substr(5));
+		FD rd(::open(path.c_str(), O_RDONLY|O_NONBLOCK|O_CLOEXEC));
+		FD wr(::open(path.c_str(), O_WRONLY|O_CLOEXEC));
+		if (rd < 0 || wr < 0) return nullptr;
+		return new JobServer(std::move(rd), std::move(wr));
+	}
+
+	auto comma = auth.find(',');
+	if (comma == auth.npos) return nullptr;
+	int r = std::atoi(std::string(auth.substr(0, comma)).c_str());
+	int w = std::atoi(std::string(auth.substr(comma+1)).c_str());
+	//make doesn't pass descriptors to commands which are not marked as recursive
+	if (r < 0 || w < 0 || fcntl(r, F_GETFD) < 0 || fcntl(w, F_GETFD) < 0) return nullptr;
+	//reopening the pipe creates own file description, so it can be non-blocking
+	//without affecting the make. The shared blocking description can't be used, other
+	//process can take the token between poll and read, so the jobserver is not used then
+	std::string procfd = "/proc/self/fd/" + std::to_string(r);
+	FD rd(::open(procfd.c_str(), O_RDONLY|O_NONBLOCK|O_CLOEXEC));
+	if (rd < 0) return nullptr;
+	FD wr(fcntl(w, F_DUPFD_CLOEXEC, 0));
+	if (rd < 0 || wr < 0) return nullptr;
+	return new JobServer(std::move(rd), std::move(wr));
+}
+
+bool JobServer::acquire(char &token, int timeout_ms) {
+	pollfd pfd = {rd, POLLIN, 0};
+	if (::poll(&pfd, 1, timeout_ms) <= 0) return false;
+	auto r = ::read(rd, &token, 1);
+	return r == 1;
+}
+
+void JobServer::release(char token) {
+	while (::write(wr, &token, 1) < 0 && errno == EINTR);
+}
@@ -0,0 +1,47 @@
+/*
+ * jobserver.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef JOBSERVER_H_
+#define JOBSERVER_H_
+
+#include "linux_spawn.h"
+
+///Client of GNU make jobserver
+/**
+ * When spamake runs from make with -jN, make passes the jobserver in the MAKEFLAGS
+ * (--jobserver-auth=R,W or --jobserver-auth=fifo:PATH). Every thread except the first one
+ * must hold a token taken from the jobserver, so the total count of running jobs stays
+ * bounded by the make
+ */
+class JobServer {
+public:
+
+	using FD = ondra_shared::ExternalProcess::FD;
+
+	JobServer(FD &&rd, FD &&wr):rd(std::move(rd)),wr(std::move(wr)) {}
+
+	///Returns jobserver of the parent make, or nullptr when there is no jobserver
+	static JobServer *instance();
+
+	///Tries to acquire a token
+	/**
+	 * @param token receives the token, it must be returned by release()
+	 * @param timeout_ms maximum time to wait in milliseconds
+	 * @retval true token acquired
+	 * @retval false timeout
+	 */
+	bool acquire(char &token, int timeout_ms);
+	///Returns the token back to jobserver
+	void release(char token);
+
+protected:
+	FD rd, wr;
+
+	static JobServer *create(const char *makeflags);
+};
+
+#endif /* JOBSERVER_H_ */
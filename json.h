@@ -0,0 +1,35 @@
+/*
+ * json.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <ostream>
+#include <string_view>
+
+///Writes string as JSON string literal. The output is safe to be embedded into <script>
+inline void writeJSONString(std::ostream &out, std::string_view str) {
+	static const char symb[] = "0123456789abcdef";
+	out << '"';
+	for (char c: str) {
+		switch (c) {
+		case '"': out << "\\\"";break;
+		case '\\': out << "\\\\";break;
+		case '\n': out << "\\n";break;
+		case '<': out << "\\u003c";break;
+		default:
+			if (static_cast<unsigned char>(c) < 32) {
+				out << "\\u00" << symb[(c >> 4) & 0xF] << symb[c & 0xF];
+			} else {
+				out << c;
+			}
+		}
+	}
+	out << '"';
+}
+
+#endif /* JSON_H_ */
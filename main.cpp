@@ -1,5 +1,8 @@
 #include <iostream>
 #include <filesystem>
+#include <cstdlib>
+#include <map>
+#include <vector>
 
 #include "builder.h"
 
@@ -11,48 +14,177 @@ static std::filesystem::path extend_filename(const std::string &fname, const std
 	return d;
 }
 
+static std::size_t parse_size(const std::string &val) {
+	char *end;
+	std::size_t r = std::strtoul(val.c_str(), &end, 10);
+	if (*end == 'k' || *end == 'K') r *= 1024;
+	else if (*end == 'm' || *end == 'M') r *= 1024*1024;
+	return r;
+}
+
+static bool parse_type(const std::string &type, BuildType &bt) {
+	if (type == "script") bt = BuildType::script_only;
+	else if (type == "html") bt = BuildType::html_only;
+	else if (type == "packed") bt = BuildType::single_page_file;
+	else if (type == "page") bt = BuildType::std_page;
+	else if (type == "devel") bt = BuildType::develop_page;
+	else if (type == "develsl") bt = BuildType::develop_page_symlink;
+	else if (type == "critical") bt = BuildType::critical_page;
+	else if (type == "esm") bt = BuildType::es_modules;
+	else {
+		std::cerr << "Unknown type: " << type << std::endl;
+		return false;
+	}
+	return true;
+}
 
 int main(int argc, char **argv) {
 
-	if (argc < 4) {
-		std::cerr << "Needs arguments: " << argv[0] << " <type> <input> <output>";
+	const char *pgm = argv[0];
+	std::size_t inline_limit = 4096;
+	std::size_t data_uri_limit = 2048;
+	bool template_bundles = false;
+	std::string report_file;
+	std::string report_html;
+	BundleReport report;
+	bool use_report = false;
+	std::vector<std::string> variant_specs;
+	std::vector<std::pair<std::string, std::string> > defines;
+	std::string artifact_cache;
+
+	int argp = 1;
+	while (argp < argc && argv[argp][0] == '-' && (argv[argp][1] == '-' || argv[argp][1] == 'D')) {
+		std::string opt = argv[argp++];
+		if (opt.size() > 2 && opt[1] == 'D') {
+			//-DNAME=VALUE
+			argv[--argp] += 2;
+			opt = "-D";
+		}
+		if (argp >= argc) {
+			std::cerr << "Option needs a value: " << opt << std::endl;
+			return 1;
+		}
+		std::string val = argv[argp++];
+		if (opt == "--inline-limit") inline_limit = parse_size(val);
+		else if (opt == "--data-uri-limit") data_uri_limit = parse_size(val);
+		else if (opt == "--templates") {
+			if (val == "bundle") template_bundles = true;
+			else if (val == "inline") template_bundles = false;
+			else {
+				std::cerr << "Invalid templates mode: " << val << " (expected inline or bundle)" << std::endl;
+				return 1;
+			}
+		}
+		else if (opt == "--report") {report_file = val; use_report = true;}
+		else if (opt == "--report-html") {report_html = val; use_report = true;}
+		else if (opt == "--budget") {
+			auto sep = val.find('=');
+			if (sep == val.npos) {
+				std::cerr << "Invalid budget: " << val << " (expected <ext>[.gz]=<size>)" << std::endl;
+				return 1;
+			}
+			std::string ext = val.substr(0, sep);
+			bool gz = ext.size() > 3 && ext.substr(ext.size()-3) == ".gz";
+			if (gz) ext.resize(ext.size()-3);
+			report.addBudget(ext, parse_size(val.substr(sep+1)), gz);
+			use_report = true;
+		} else if (opt == "--artifact-cache") {
+			artifact_cache = val;
+		} else if (opt == "--variant") {
+			variant_specs.push_back(val);
+		} else if (opt == "-D") {
+			auto sep = val.find('=');
+			if (sep == val.npos) defines.emplace_back(val, "1");
+			else defines.emplace_back(val.substr(0, sep), val.substr(sep+1));
+		} else {
+			std::cerr << "Unknown option: " << opt << std::endl;
+			return 1;
+		}
+	}
+	argv += argp-1;
+	argc -= argp-1;
+
+	if (argc < 4 && (variant_specs.empty() || argc != 2)) {
+		std::cerr << "Needs arguments: " << pgm << " [options] <type> <input> <output>" << std::endl;
+		std::cerr << "            or: " << pgm << " [options] --variant <type>:<output>[:<lang>] ... <input>";
 		std::cerr << std::endl;
 		std::cerr << "type=script    build script only, no other files are created" << std::endl
 				  << "type=html      build only html, no other files are created" << std::endl
 				  << "type=packed    pack everything into signle page" << std::endl
 				  << "type=page      build standard page" << std::endl
 				  << "type=devel     create page suitable for develping" << std::endl
-		          << "type=develsl   create page suitable for develping (symlink resources)" << std::endl;
+		          << "type=develsl   create page suitable for develping (symlink resources)" << std::endl
+		          << "type=critical  build standard page, inline critical styles, load the rest asynchronously" << std::endl
+		          << "type=esm       build page where every script is native ES module" << std::endl
+		          << std::endl
+		          << "--inline-limit <bytes>   inline script and style bundles smaller than limit (type=critical, default 4096)" << std::endl
+		          << "--data-uri-limit <bytes> inline assets referenced by styles smaller than limit as data URI (default 2048)" << std::endl
+		          << "--templates <mode>       inline: templates in page (default), bundle: load templates on demand" << std::endl
+		          << "--report <file>          write composition of the outputs as JSON" << std::endl
+		          << "--report-html <file>     write composition of the outputs as HTML treemap" << std::endl
+		          << "--budget <ext>[.gz]=<size>  fail when an output with extension is larger than size" << std::endl
+		          << "--variant <type>:<output>[:<lang>]  build additional variant from the same input" << std::endl
+		          << "-D <name>[=<value>]      define flag for //@if directive" << std::endl
+		          << "--artifact-cache <dir>   restore outputs from shared cache when inputs are same" << std::endl;
 		return 1;
 	}
 
-	BuildType bt;
-	std::string type = argv[1];
-	if (type == "script") bt = BuildType::script_only;
-	else if (type == "html") bt = BuildType::html_only;
-	else if (type == "packed") bt = BuildType::single_page_file;
-	else if (type == "page") bt = BuildType::std_page;
-	else if (type == "devel") bt = BuildType::develop_page;
-	else if (type == "develsl") bt = BuildType::develop_page_symlink;
-	else {
-		std::cerr << "Unknown type: " << type << std::endl;
-		return 1;
-	}
-	std::string input = argv[2];
-	std::string output = argv[3];
 	auto cwd = std::filesystem::current_path();
+	std::vector<Builder::Variant> variants;
+	std::string input;
+	if (argc == 2) {
+		input = argv[1];
+	} else {
+		BuildType bt;
+		if (!parse_type(argv[1], bt)) return 1;
+		input = argv[2];
+		variants.push_back({bt, extend_filename(argv[3], cwd), std::string()});
+	}
+	for (const std::string &spec: variant_specs) {
+		auto s1 = spec.find(':');
+		if (s1 == spec.npos) {
+			std::cerr << "Invalid variant: " << spec << " (expected <type>:<output>[:<lang>])" << std::endl;
+			return 1;
+		}
+		auto s2 = spec.find(':', s1+1);
+		BuildType bt;
+		if (!parse_type(spec.substr(0, s1), bt)) return 1;
+		std::string output = spec.substr(s1+1, s2 == spec.npos?spec.npos:s2-s1-1);
+		std::string lang = s2 == spec.npos?std::string():spec.substr(s2+1);
+		variants.push_back({bt, extend_filename(output, cwd), lang});
+	}
+
 	auto infile = extend_filename(input, cwd);
-	auto outfile = extend_filename(output, cwd);
-	auto cache = extend_filename(".cache", outfile.parent_path());
-	auto dep = extend_filename(outfile.filename().string()+".d", cwd);
+	auto cache = extend_filename(".cache", variants.front().out.parent_path());
 
 
 	try {
 		Builder bld(cache);
+		bld.setInlineLimit(inline_limit);
+		bld.setDataURILimit(data_uri_limit);
+		bld.setTemplateBundles(template_bundles);
+		if (use_report) bld.setReport(&report);
+		for (const auto &[name, value]: defines) bld.define(name, value);
+		if (!artifact_cache.empty()) bld.setArtifactCache(extend_filename(artifact_cache, cwd));
 		bld.parse(infile);
-		bld.build(outfile, bt);
-		bld.create_dep_file(dep, outfile);
-		std::cout << "Built: " << outfile.string() << std::endl;
+		bld.build(variants);
+		//variants with the same output name share the dep file
+		std::map<std::filesystem::path, std::vector<std::filesystem::path> > deps;
+		for (const auto &v: variants) {
+			deps[extend_filename(v.out.filename().string()+".d", cwd)].push_back(v.out);
+		}
+		for (const auto &[dep, outputs]: deps) {
+			bld.create_dep_file(dep, outputs);
+		}
+		if (use_report) {
+			report.finish();
+			if (!report_file.empty()) report.writeJSON(extend_filename(report_file, cwd));
+			if (!report_html.empty()) report.writeHTML(extend_filename(report_html, cwd));
+			report.checkBudgets();
+		}
+		for (const auto &v: variants) {
+			std::cout << "Built: " << v.out.string() << std::endl;
+		}
 	} catch (std::exception &e) {
 		std::cerr << e.what() << std::endl;
 		return 2;
@@ -61,5 +193,3 @@ int main(int argc, char **argv) {
 
 	return 0;
 }
-
-
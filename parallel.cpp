@@ -0,0 +1,98 @@
+/*
+ * parallel.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "jobserver.h"
+#include "parallel.h"
+
+namespace {
+
+///Tokens of the process used when there is no jobserver
+/**
+ * Nested pools share the same tokens, so the count of running threads stays bounded
+ */
+class LocalTokens {
+public:
+	LocalTokens(unsigned int count):count(count) {}
+
+	bool acquire(int timeout_ms) {
+		std::unique_lock _(lock);
+		if (!cond.wait_for(_, std::chrono::milliseconds(timeout_ms), [&]{return count > 0;})) return false;
+		--count;
+		return true;
+	}
+	void release() {
+		std::lock_guard _(lock);
+		++count;
+		cond.notify_one();
+	}
+
+protected:
+	std::mutex lock;
+	std::condition_variable cond;
+	unsigned int count;
+};
+
+}
+
+void runParallel(const std::vector<Job> &jobs) {
+	if (jobs.size() < 2) {
+		for (const Job &j: jobs) j();
+		return;
+	}
+
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex lock;
+
+	auto worker = [&]{
+		while (!failed) {
+			std::size_t idx = next++;
+			if (idx >= jobs.size()) break;
+			try {
+				jobs[idx]();
+			} catch (...) {
+				std::lock_guard _(lock);
+				if (!error) error = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+
+	//the calling thread runs on implicit token, other threads need token from the make,
+	//or from the local tokens of the process
+	unsigned int hw = std::max(1U, std::thread::hardware_concurrency());
+	static LocalTokens local(hw - 1);
+	JobServer *jobserver = JobServer::instance();
+	auto helper = [&]{
+		char token;
+		while (!failed && next < jobs.size()) {
+			if (jobserver?jobserver->acquire(token, 50):local.acquire(50)) {
+				worker();
+				if (jobserver) jobserver->release(token); else local.release();
+				break;
+			}
+		}
+	};
+
+	std::size_t cnt = std::min<std::size_t>(hw, jobs.size()) - 1;
+	std::vector<std::thread> threads;
+	threads.reserve(cnt);
+	for (std::size_t i = 0; i < cnt; i++) {
+		threads.emplace_back(helper);
+	}
+	worker();
+	for (auto &t: threads) t.join();
+	if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,27 @@
+/*
+ * parallel.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <functional>
+#include <vector>
+
+using Job = std::function<void()>;
+
+///Runs independent jobs on a pool of worker threads
+/**
+ * The calling thread takes part in the work. The function returns after all jobs are finished.
+ * If any job throws an exception, no more jobs are started and the first exception is rethrown.
+ *
+ * Additional threads run only while they hold a token. Tokens are taken from GNU make jobserver,
+ * or from the process-wide budget of hardware_concurrency()-1 tokens when there is no jobserver,
+ * so nested calls don't oversubscribe the CPU
+ */
+void runParallel(const std::vector<Job> &jobs);
+
+#endif /* PARALLEL_H_ */
@@ -0,0 +1,61 @@
+/*
+ * pathtable.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "pathtable.h"
+
+PathTable::ID PathTable::intern(const std::filesystem::path &p) {
+	std::lock_guard _(lock);
+	auto iter = index.find(p.native());
+	if (iter != index.end()) return iter->second;
+	ID id = static_cast<ID>(paths.size());
+	paths.push_back(p);
+	index.emplace(p.native(), id);
+	return id;
+}
+
+const std::string &PathTable::relative(ID base, ID id) {
+	std::lock_guard _(lock);
+	std::uint64_t key = (static_cast<std::uint64_t>(base) << 32) | id;
+	auto iter = relcache.find(key);
+	if (iter == relcache.end()) {
+		iter = relcache.emplace(key, makeRelative(paths[base], paths[id])).first;
+	}
+	return iter->second;
+}
+
+std::string PathTable::makeRelative(const std::filesystem::path &rel, const std::filesystem::path &link) {
+	std::string res;
+	auto ir = rel.begin();
+	auto il = link.begin();
+	while (ir != rel.end() && il != link.end()) {
+		if (*ir == *il) {
+			++ir;
+			++il;
+		} else {
+			auto n = res.size();
+			while (ir != rel.end()) {
+				n = res.size();
+				res.append("../");
+				++ir;
+			}
+			res.resize(n);
+			break;
+		}
+	}
+	if (il != link.end()) {
+		while (il != link.end()) {
+			res.append(*il);
+			res.push_back('/');
+			++il;
+		}
+		res.pop_back();
+	} else {
+		res.append(link.filename());
+	}
+
+	return res;
+}
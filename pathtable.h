@@ -0,0 +1,56 @@
+/*
+ * pathtable.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef PATHTABLE_H_
+#define PATHTABLE_H_
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+///Interned table of paths
+/**
+ * Every path is stored only once and it is referenced by its ID. IDs are small integers
+ * allocated sequentially, so they can be used as index to vectors. The table can be
+ * accessed from multiple threads, references to stored paths remain valid
+ */
+class PathTable {
+public:
+
+	using ID = unsigned int;
+
+	///Retrieves ID of the path, the path is added when it is not in the table yet
+	ID intern(const std::filesystem::path &p);
+	///Retrieves path by ID
+	const std::filesystem::path &operator[](ID id) const {
+		std::lock_guard _(lock);
+		return paths[id];
+	}
+	///Count of paths in the table
+	std::size_t size() const {
+		std::lock_guard _(lock);
+		return paths.size();
+	}
+
+	///Retrieves path of the item relative to the base. The result is calculated only once
+	const std::string &relative(ID base, ID id);
+
+	///Calculates path of the link relative to the rel
+	static std::string makeRelative(const std::filesystem::path &rel, const std::filesystem::path &link);
+
+protected:
+
+	mutable std::mutex lock;
+	std::deque<std::filesystem::path> paths;
+	std::unordered_map<std::string, ID> index;
+	std::unordered_map<std::uint64_t, std::string> relcache;
+};
+
+#endif /* PATHTABLE_H_ */
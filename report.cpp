@@ -0,0 +1,167 @@
+/*
+ * report.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+#include "json.h"
+#include "parallel.h"
+#include "pathtable.h"
+#include "report.h"
+
+void BundleReport::record(const std::filesystem::path &output, const std::filesystem::path &source, const std::string &data) {
+	std::error_code ec;
+	Contribution c;
+	c.source = source.string();
+	c.raw = std::filesystem::file_size(source, ec);
+	if (ec) c.raw = 0;
+	c.minified = data.size();
+	c.gzipped = gzipSize(data);
+	std::lock_guard _(lock);
+	outputs[output].sources.push_back(std::move(c));
+}
+
+void BundleReport::addOutput(const std::filesystem::path &output) {
+	std::lock_guard _(lock);
+	outputs[output];
+}
+
+void BundleReport::move(const std::filesystem::path &from, const std::filesystem::path &to) {
+	std::lock_guard _(lock);
+	auto iter = outputs.find(from);
+	if (iter == outputs.end()) return;
+	auto &trg = outputs[to].sources;
+	for (auto &c: iter->second.sources) trg.push_back(std::move(c));
+	outputs.erase(iter);
+}
+
+void BundleReport::finish() {
+	std::vector<Job> jobs;
+	for (auto &[name, out]: outputs) {
+		jobs.push_back([&name = name, &out = out]{
+			std::ifstream in(name, std::ios::in|std::ios::binary);
+			if (!in) return;
+			std::ostringstream buff;
+			buff << in.rdbuf();
+			std::string data = buff.str();
+			out.size = data.size();
+			out.gzipped = gzipSize(data);
+		});
+	}
+	runParallel(jobs);
+}
+
+void BundleReport::addBudget(const std::string &ext, std::size_t limit, bool gzipped) {
+	budgets.push_back({ext, limit, gzipped});
+}
+
+void BundleReport::checkBudgets() const {
+	std::string errors;
+	for (const auto &[name, out]: outputs) {
+		auto ext = name.extension().string();
+		if (!ext.empty()) ext = ext.substr(1);
+		for (const Budget &b: budgets) {
+			if (b.ext != ext) continue;
+			std::size_t sz = b.gzipped?out.gzipped:out.size;
+			if (sz > b.limit) {
+				if (!errors.empty()) errors.push_back('\n');
+				errors.append(name.string()).append(": over budget ")
+					.append(std::to_string(sz)).append(" > ").append(std::to_string(b.limit))
+					.append(b.gzipped?" bytes (gzipped)":" bytes");
+			}
+		}
+	}
+	if (!errors.empty()) throw std::runtime_error(errors);
+}
+
+std::size_t BundleReport::gzipSize(const std::string &data) {
+	z_stream strm = {};
+	if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("Failed to initialize zlib");
+	}
+	std::vector<unsigned char> buff(deflateBound(&strm, data.size()));
+	strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+	strm.avail_in = static_cast<uInt>(data.size());
+	strm.next_out = buff.data();
+	strm.avail_out = static_cast<uInt>(buff.size());
+	deflate(&strm, Z_FINISH);
+	std::size_t sz = strm.total_out;
+	deflateEnd(&strm);
+	return sz;
+}
+
+void BundleReport::writeJSON(std::ostream &out, const std::filesystem::path &rel) const {
+	out << "{\"outputs\":[";
+	bool firstOut = true;
+	for (const auto &[name, o]: outputs) {
+		if (!firstOut) out << ",";
+		firstOut = false;
+		out << std::endl << "{\"output\":";
+		writeJSONString(out, PathTable::makeRelative(rel, name));
+		out << ",\"size\":" << o.size << ",\"gzipped\":" << o.gzipped << ",\"sources\":[";
+		bool first = true;
+		for (const Contribution &c: o.sources) {
+			if (!first) out << ",";
+			first = false;
+			out << std::endl << "\t{\"source\":";
+			writeJSONString(out, PathTable::makeRelative(rel, c.source));
+			out << ",\"raw\":" << c.raw << ",\"minified\":" << c.minified << ",\"gzipped\":" << c.gzipped << "}";
+		}
+		out << "]}";
+	}
+	out << "]}" << std::endl;
+}
+
+void BundleReport::writeJSON(const std::filesystem::path &file) const {
+	std::ofstream out(file, std::ios::out|std::ios::trunc);
+	writeJSON(out, file);
+	if (!out) throw std::runtime_error(file.string() + ": failed to write");
+}
+
+void BundleReport::writeHTML(const std::filesystem::path &file) const {
+	std::ofstream out(file, std::ios::out|std::ios::trunc);
+	out << R"html(<!DOCTYPE html><HTML><HEAD><META charset="UTF-8" /><TITLE>Bundle report</TITLE><style type="text/css">
+body {font-family: sans-serif;margin:0}
+#map {position:relative;width:100vw;height:100vh}
+#map div {position:absolute;box-sizing:border-box;border:1px solid #fff;overflow:hidden;font-size:11px;padding:2px}
+#map .out {background:#345;color:#fff}
+#map .src {background:#7ab;color:#000}
+</style></HEAD><BODY><div id="map"></div><script type="text/javascript">
+var report=)html";
+	writeJSON(out, file);
+	out << R"html(;
+(function(){
+var field = "gzipped";
+var map = document.getElementById("map");
+function box(cls, label, title, x, y, w, h) {
+	var d = document.createElement("div");
+	d.className = cls;
+	d.style.left = x+"px";d.style.top = y+"px";d.style.width = w+"px";d.style.height = h+"px";
+	d.textContent = label;
+	d.title = title;
+	map.appendChild(d);
+}
+function layout(items, x, y, w, h, horz, fn) {
+	var total = items.reduce(function(a,b){return a+b[field];},0) || 1;
+	items.forEach(function(it){
+		var part = it[field]/total;
+		if (horz) {fn(it, x, y, w*part, h);x += w*part;}
+		else {fn(it, x, y, w, h*part);y += h*part;}
+	});
+}
+layout(report.outputs, 0, 0, map.clientWidth, map.clientHeight, true, function(o, x, y, w, h) {
+	box("out", o.output, o.output+": "+o.size+" B, "+o.gzipped+" B gzipped", x, y, w, 16);
+	layout(o.sources, x, y+16, w, h-16, false, function(s, x, y, w, h) {
+		box("src", s.source, s.source+": raw "+s.raw+" B, minified "+s.minified+" B, gzipped "+s.gzipped+" B", x, y, w, h);
+	});
+});
+})();
+</script></BODY></HTML>
+)html";
+	if (!out) throw std::runtime_error(file.string() + ": failed to write");
+}
@@ -0,0 +1,78 @@
+/*
+ * report.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+///Collects composition of the generated outputs
+/**
+ * Every source file emitted into an output is recorded with its raw size (size of the source file),
+ * minified size (bytes actually emitted) and gzipped size. The report can be stored as JSON or
+ * as self-contained HTML treemap. Budgets allow to fail the build when an output is too large
+ */
+class BundleReport {
+public:
+
+	struct Contribution {
+		std::string source;
+		std::size_t raw = 0;
+		std::size_t minified = 0;
+		std::size_t gzipped = 0;
+	};
+
+	struct Output {
+		std::vector<Contribution> sources;
+		std::size_t size = 0;
+		std::size_t gzipped = 0;
+	};
+
+	///Record contribution of the source to the output
+	void record(const std::filesystem::path &output, const std::filesystem::path &source, const std::string &data);
+	///Registers the output, so it is reported and checked even if no source contributed to it
+	void addOutput(const std::filesystem::path &output);
+	///Moves all contributions of one output to other output (when content is inlined)
+	void move(const std::filesystem::path &from, const std::filesystem::path &to);
+	///Measures final size of all outputs
+	void finish();
+
+	///Adds budget
+	/**
+	 * @param ext extension of the output (js, css, html)
+	 * @param limit maximum size in bytes
+	 * @param gzipped limit applies to gzipped size
+	 */
+	void addBudget(const std::string &ext, std::size_t limit, bool gzipped);
+	///Checks budgets, throws exception when any output is over the budget
+	void checkBudgets() const;
+
+	void writeJSON(const std::filesystem::path &file) const;
+	void writeHTML(const std::filesystem::path &file) const;
+
+	static std::size_t gzipSize(const std::string &data);
+
+protected:
+
+	struct Budget {
+		std::string ext;
+		std::size_t limit;
+		bool gzipped;
+	};
+
+	std::mutex lock;
+	std::map<std::filesystem::path, Output> outputs;
+	std::vector<Budget> budgets;
+
+	void writeJSON(std::ostream &out, const std::filesystem::path &rel) const;
+};
+
+#endif /* REPORT_H_ */
@@ -0,0 +1,37 @@
+/*
+ * sha256.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+///Incremental SHA-256 digest
+class Sha256 {
+public:
+
+	Sha256();
+
+	///Appends data to the digest
+	void update(std::string_view data);
+	///Appends data followed by a separator, so consecutive fields can't be confused
+	void field(std::string_view data) {update(data); update(std::string_view("\0", 1));}
+	///Finishes the digest, returns it as hex string (64 characters)
+	std::string hex();
+
+protected:
+	std::uint32_t state[8];
+	unsigned char block[64];
+	std::size_t blocklen = 0;
+	std::uint64_t length = 0;
+
+	void transform(const unsigned char *data);
+};
+
+#endif /* SHA256_H_ */